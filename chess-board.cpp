@@ -3,6 +3,21 @@
 #include <string>
 #include <chrono>
 #include <algorithm>
+#include <fstream>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cctype>
+#include <queue>
+#include <functional>
+#include <limits>
+#include <array>
+#include <map>
+#include <thread>
+#include <cstring>
+#include <cmath>
+#include <random>
 
 using namespace std;
 
@@ -56,6 +71,235 @@ using namespace std;
 		cout << "✅  PASS" << endl;                                                           \
 	}
 
+/**
+ * Records timed spans from every thread and writes them out as Chrome trace-event JSON,
+ * which can be opened in chrome://tracing or https://ui.perfetto.dev
+ *
+ * Each thread appends to its own buffer without taking a lock. A buffer is only written out
+ * (under the file lock) once it fills up, and the rest are written at exit, so memory stays bounded
+ * however long tracing is left on. When a thread exits its buffer is handed to the next new thread,
+ * so short-lived worker threads reuse the same few trace rows instead of adding one per thread.
+ * While tracing is disabled, a span costs a single relaxed atomic load.
+ */
+class Tracer
+{
+public:
+	struct Event
+	{
+		const char *name;
+		long long start;
+		long long duration;
+	};
+
+	struct ThreadBuffer
+	{
+		int tid;
+		vector<Event> events;
+	};
+
+	/**
+	 * Number of spans a thread keeps in memory before writing them to the trace file
+	 */
+	static const size_t BUFFER_SIZE = 4096;
+
+	static Tracer &instance()
+	{
+		static Tracer tracer;
+		return tracer;
+	}
+
+	~Tracer()
+	{
+		flush();
+	}
+
+	/**
+	 * Start recording spans to the given file. Must be called from the main thread.
+	 * @param path file to write the trace to
+	 * @return bool false if the file couldn't be opened
+	 */
+	bool enable(const string &path)
+	{
+		output.open(path, ios::binary);
+		if (!output)
+		{
+			return false;
+		}
+		output << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+		mainThread = this_thread::get_id();
+		enabled.store(true, memory_order_relaxed);
+		return true;
+	}
+
+	bool isEnabled() const
+	{
+		return enabled.load(memory_order_relaxed);
+	}
+
+	/**
+	 * Microseconds since the tracer was created
+	 */
+	long long now() const
+	{
+		return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - epoch).count();
+	}
+
+	/**
+	 * Append a completed span to the calling thread's buffer
+	 */
+	void record(const char *name, long long start, long long end)
+	{
+		thread_local BufferLease lease;
+		if (!lease.buffer)
+		{
+			lease.buffer = acquireBuffer();
+		}
+		lease.buffer->events.push_back({name, start, end - start});
+		if (lease.buffer->events.size() >= BUFFER_SIZE)
+		{
+			lock_guard<mutex> lock(outputMutex);
+			writeEvents(*lease.buffer);
+		}
+	}
+
+	/**
+	 * Write every remaining span and close the trace file. Called automatically at exit.
+	 */
+	void flush()
+	{
+		if (!isEnabled())
+		{
+			return;
+		}
+		enabled.store(false, memory_order_relaxed);
+
+		lock_guard<mutex> lock(outputMutex);
+		for (const auto &buffer : buffers)
+		{
+			writeEvents(*buffer);
+		}
+		output << "]}\n";
+		output.close();
+		if (!output)
+		{
+			cerr << "Failed to write trace" << endl;
+		}
+	}
+
+private:
+	/**
+	 * Returns a thread's buffer to the tracer when the thread exits
+	 */
+	struct BufferLease
+	{
+		ThreadBuffer *buffer = nullptr;
+
+		~BufferLease()
+		{
+			if (buffer)
+			{
+				Tracer::instance().releaseBuffer(buffer);
+			}
+		}
+	};
+
+	atomic<bool> enabled{false};
+	chrono::steady_clock::time_point epoch = chrono::steady_clock::now();
+	thread::id mainThread;
+
+	mutex outputMutex;
+	ofstream output;
+	bool isFirstEvent = true;
+
+	mutex buffersMutex;
+	vector<unique_ptr<ThreadBuffer>> buffers;
+	vector<ThreadBuffer *> freeBuffers;
+
+	/**
+	 * Give the calling thread a buffer, reusing one left by an exited worker thread if there is one.
+	 * Only locks once per thread.
+	 */
+	ThreadBuffer *acquireBuffer()
+	{
+		bool isMain = this_thread::get_id() == mainThread;
+		ThreadBuffer *buffer;
+		{
+			lock_guard<mutex> lock(buffersMutex);
+			if (!isMain && !freeBuffers.empty())
+			{
+				buffer = freeBuffers.back();
+				freeBuffers.pop_back();
+				return buffer;
+			}
+			buffers.push_back(unique_ptr<ThreadBuffer>(new ThreadBuffer{int(buffers.size()), {}}));
+			buffer = buffers.back().get();
+		}
+
+		string tid = to_string(buffer->tid);
+		lock_guard<mutex> lock(outputMutex);
+		writeJson("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" + tid +
+				  ",\"args\":{\"name\":\"" + (isMain ? "main" : "worker " + tid) + "\"}}");
+		return buffer;
+	}
+
+	void releaseBuffer(ThreadBuffer *buffer)
+	{
+		lock_guard<mutex> lock(buffersMutex);
+		freeBuffers.push_back(buffer);
+	}
+
+	/**
+	 * Write out and clear a buffer's spans. Caller must hold `outputMutex`.
+	 */
+	void writeEvents(ThreadBuffer &buffer)
+	{
+		string tid = to_string(buffer.tid);
+		for (const auto &event : buffer.events)
+		{
+			writeJson("{\"name\":\"" + string(event.name) + "\",\"cat\":\"solver\",\"ph\":\"X\",\"pid\":1,\"tid\":" + tid +
+					  ",\"ts\":" + to_string(event.start) + ",\"dur\":" + to_string(event.duration) + "}");
+		}
+		buffer.events.clear();
+	}
+
+	/**
+	 * Append one event to the trace file. Caller must hold `outputMutex`.
+	 */
+	void writeJson(const string &event)
+	{
+		if (!isFirstEvent)
+		{
+			output << ',';
+		}
+		output << event;
+		isFirstEvent = false;
+	}
+};
+
+/**
+ * Times the enclosing scope and records it as a span when tracing is enabled
+ */
+class TraceSpan
+{
+public:
+	TraceSpan(const char *name) : name(name)
+	{
+		start = Tracer::instance().isEnabled() ? Tracer::instance().now() : -1;
+	}
+
+	~TraceSpan()
+	{
+		if (start >= 0 && Tracer::instance().isEnabled())
+		{
+			Tracer::instance().record(name, start, Tracer::instance().now());
+		}
+	}
+
+private:
+	const char *name;
+	long long start;
+};
+
 /**
  * Class to represent a single square on the board
  */
@@ -67,6 +311,11 @@ public:
 	float height;
 	bool isTouched;
 	bool isEdge;
+
+	/**
+	 * True if the square has a non-ascending path to the edge, so it can never hold water
+	 */
+	bool isDry;
 	float waterLevel;
 
 	/**
@@ -79,6 +328,7 @@ public:
 	{
 		waterLevel = 0;
 		isTouched = false;
+		isDry = false;
 	}
 
 	float totalHeight() const
@@ -87,6 +337,533 @@ public:
 	}
 };
 
+/**
+ * Write a contiguous row-major array to disk as a NumPy `.npy` file.
+ * The whole file is assembled in memory and written with a single call,
+ * so it can be loaded zero-copy from Python with `np.load(path, mmap_mode='r')`.
+ *
+ * @param path file to write
+ * @param data array values, row-major
+ * @param shape dimensions of the array
+ * @param descr NumPy type descriptor matching T (e.g. "<f4", "<i4")
+ * @return bool true if the file was written
+ */
+template <typename T>
+bool writeNpy(const string &path, const vector<T> &data, const vector<size_t> &shape, const string &descr)
+{
+	string shapeStr = "(";
+	for (size_t dim : shape)
+	{
+		shapeStr += to_string(dim) + ", ";
+	}
+	// One-dimensional shapes keep their trailing comma, as in Python: (n,)
+	shapeStr.erase(shapeStr.size() - (shape.size() > 1 ? 2 : 1));
+	shapeStr += ")";
+
+	string header = "{'descr': '" + descr + "', 'fortran_order': False, 'shape': " + shapeStr + ", }";
+
+	// Magic (6) + version (2) + header length (2) + header must be a multiple of 64 and end in a newline
+	size_t preamble = 10;
+	size_t padding = 64 - (preamble + header.size() + 1) % 64;
+	header.append(padding % 64, ' ');
+	header += '\n';
+
+	string buffer = "\x93NUMPY";
+	buffer += char(1);
+	buffer += char(0);
+	buffer += char(header.size() & 0xff);
+	buffer += char((header.size() >> 8) & 0xff);
+	buffer += header;
+	buffer.append(reinterpret_cast<const char *>(data.data()), data.size() * sizeof(T));
+
+	ofstream file(path, ios::binary);
+	file.write(buffer.data(), buffer.size());
+	return bool(file);
+}
+
+/**
+ * Find the spill level of every cell on a grid: the lowest water surface height it can hold
+ * before water escapes over an edge cell. A cell holds `level - height` of water.
+ *
+ * This is a priority flood: starting from the edge cells, always grow inwards from the lowest
+ * cell reached so far, so every cell is reached along the lowest possible route to the edge.
+ *
+ * @param rows number of rows in the grid
+ * @param cols number of columns in the grid
+ * @param heights row-major cell heights
+ * @param isEdge row-major flags for cells water can fall off
+ * @return vector<float> row-major spill levels
+ */
+vector<float> getSpillLevels(int rows, int cols, const vector<float> &heights, const vector<char> &isEdge)
+{
+	vector<float> levels(heights);
+	vector<bool> isVisited(heights.size(), false);
+	priority_queue<pair<float, int>, vector<pair<float, int>>, greater<pair<float, int>>> queue;
+
+	for (int i = 0; i < rows * cols; i++)
+	{
+		if (isEdge[i])
+		{
+			isVisited[i] = true;
+			queue.push({heights[i], i});
+		}
+	}
+
+	while (!queue.empty())
+	{
+		float level = queue.top().first;
+		int cell = queue.top().second;
+		queue.pop();
+
+		int row = cell / cols;
+		int col = cell % cols;
+		int neighbours[] = {
+			row > 0 ? cell - cols : -1,
+			row < rows - 1 ? cell + cols : -1,
+			col > 0 ? cell - 1 : -1,
+			col < cols - 1 ? cell + 1 : -1,
+		};
+		for (int neighbour : neighbours)
+		{
+			if (neighbour < 0 || isVisited[neighbour])
+			{
+				continue;
+			}
+			isVisited[neighbour] = true;
+			levels[neighbour] = max(heights[neighbour], level);
+			queue.push({levels[neighbour], neighbour});
+		}
+	}
+	return levels;
+}
+
+/**
+ * Work queue for one thread of `getSpillLevelsParallel()`.
+ * Cells are kept in buckets of similar water level so the lowest are processed first,
+ * and other threads can steal from the lowest bucket when their own queue runs dry.
+ */
+class SpillWorkQueue
+{
+public:
+	/**
+	 * Add cells with their water levels at the time they were queued
+	 */
+	void push(const vector<pair<int, float>> &cells, float delta)
+	{
+		lock_guard<mutex> lock(queueMutex);
+		for (const auto &cell : cells)
+		{
+			buckets[long(cell.second / delta)].push_back(cell);
+		}
+	}
+
+	/**
+	 * Take every cell from the lowest bucket, used by both the owner and thieves
+	 * @return bool false if the queue is empty
+	 */
+	bool popLowest(vector<pair<int, float>> &cells)
+	{
+		lock_guard<mutex> lock(queueMutex);
+		if (buckets.empty())
+		{
+			return false;
+		}
+		cells.swap(buckets.begin()->second);
+		buckets.erase(buckets.begin());
+		return true;
+	}
+
+private:
+	mutex queueMutex;
+	map<long, vector<pair<int, float>>> buckets;
+};
+
+/**
+ * Parallel version of `getSpillLevels()` for single large boards.
+ *
+ * Rather than one global priority queue, each thread works through its own bucketed queue
+ * in roughly ascending water level, stealing from other threads when it runs out of work.
+ * Because cells are no longer processed in exact order, a cell may be reached by a route that
+ * isn't its lowest; when a lower route turns up later its level is lowered and it is queued again,
+ * so the result is still exact once every queue is empty.
+ *
+ * @param rows number of rows in the grid
+ * @param cols number of columns in the grid
+ * @param heights row-major cell heights
+ * @param isSource row-major flags for cells whose level is already known to be their height
+ *                 (the edge cells, and optionally any other cells that drain off the board)
+ * @param threads number of worker threads
+ * @param delta range of water levels sharing a bucket, or 0 to pick one from the height range
+ * @return vector<float> row-major spill levels
+ */
+vector<float> getSpillLevelsParallel(int rows, int cols, const vector<float> &heights, const vector<char> &isSource, int threads, float delta = 0)
+{
+	threads = max(threads, 1);
+	if (delta <= 0)
+	{
+		float minHeight = *min_element(heights.begin(), heights.end());
+		float maxHeight = *max_element(heights.begin(), heights.end());
+		delta = maxHeight > minHeight ? (maxHeight - minHeight) / 1024 : 1;
+	}
+
+	int size = rows * cols;
+	unique_ptr<atomic<float>[]> levels(new atomic<float>[size]);
+	vector<SpillWorkQueue> queues(threads);
+	atomic<long> pending(0);
+
+	// Seed each thread with the sources in its band of rows
+	// Sources surrounded by other sources can't lower anything, so they are left out
+	vector<vector<pair<int, float>>> seeds(threads);
+	for (int i = 0; i < size; i++)
+	{
+		levels[i].store(isSource[i] ? heights[i] : numeric_limits<float>::infinity(), memory_order_relaxed);
+		if (!isSource[i])
+		{
+			continue;
+		}
+		int row = i / cols;
+		int col = i % cols;
+		bool isFrontier = (row > 0 && !isSource[i - cols]) || (row < rows - 1 && !isSource[i + cols]) ||
+						  (col > 0 && !isSource[i - 1]) || (col < cols - 1 && !isSource[i + 1]);
+		if (isFrontier)
+		{
+			seeds[long(row) * threads / rows].push_back({i, heights[i]});
+		}
+	}
+	for (int t = 0; t < threads; t++)
+	{
+		pending += seeds[t].size();
+		queues[t].push(seeds[t], delta);
+	}
+
+	auto worker = [&](int self)
+	{
+		TraceSpan span("relax");
+		vector<pair<int, float>> cells;
+		vector<pair<int, float>> lowered;
+		while (pending.load() > 0)
+		{
+			bool hasWork = queues[self].popLowest(cells);
+			for (int victim = (self + 1) % threads; !hasWork && victim != self; victim = (victim + 1) % threads)
+			{
+				hasWork = queues[victim].popLowest(cells);
+			}
+			if (!hasWork)
+			{
+				this_thread::yield();
+				continue;
+			}
+
+			for (const auto &cell : cells)
+			{
+				float level = levels[cell.first].load(memory_order_relaxed);
+
+				// Skip stale entries, the cell has since been queued again at a lower level
+				if (level < cell.second)
+				{
+					continue;
+				}
+
+				int row = cell.first / cols;
+				int col = cell.first % cols;
+				int neighbours[] = {
+					row > 0 ? cell.first - cols : -1,
+					row < rows - 1 ? cell.first + cols : -1,
+					col > 0 ? cell.first - 1 : -1,
+					col < cols - 1 ? cell.first + 1 : -1,
+				};
+				for (int neighbour : neighbours)
+				{
+					if (neighbour < 0 || isSource[neighbour])
+					{
+						continue;
+					}
+					float candidate = max(heights[neighbour], level);
+					float current = levels[neighbour].load(memory_order_relaxed);
+					while (candidate < current && !levels[neighbour].compare_exchange_weak(current, candidate, memory_order_relaxed))
+					{
+					}
+					if (candidate < current)
+					{
+						lowered.push_back({neighbour, candidate});
+					}
+				}
+			}
+
+			// Count new work before retiring this batch, so `pending` never drops to 0 early
+			pending += lowered.size();
+			queues[self].push(lowered, delta);
+			pending -= cells.size();
+			cells.clear();
+			lowered.clear();
+		}
+	};
+
+	vector<thread> workers;
+	for (int t = 1; t < threads; t++)
+	{
+		workers.emplace_back(worker, t);
+	}
+	worker(0);
+	for (auto &workerThread : workers)
+	{
+		workerThread.join();
+	}
+
+	vector<float> result(size);
+	for (int i = 0; i < size; i++)
+	{
+		result[i] = levels[i].load(memory_order_relaxed);
+	}
+	return result;
+}
+
+/**
+ * Exact sum of floats, with one integer bin per float exponent so no bits are ever rounded away.
+ * Bin `e` counts units of 2^(e - 150), the value of the last mantissa bit of a float with biased exponent `e`.
+ * Bins are plain integers, so the total doesn't depend on the order values are added in.
+ */
+class ExactFloatSum
+{
+public:
+	/**
+	 * Add a single float
+	 */
+	void add(float value)
+	{
+		uint32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		int exponent = (bits >> 23) & 0xff;
+		int64_t mantissa = bits & 0x7fffff;
+
+		// Subnormals have no implicit leading bit, but share the units of the smallest normal exponent
+		if (exponent == 0)
+		{
+			exponent = 1;
+		}
+		else
+		{
+			mantissa |= 0x800000;
+		}
+		addUnits(bits >> 31 ? -mantissa : mantissa, exponent);
+	}
+
+	/**
+	 * Add a whole number of units of 2^(exponent - 150)
+	 */
+	void addUnits(int64_t units, int exponent)
+	{
+		bins[exponent] += units;
+	}
+
+	void add(const ExactFloatSum &other)
+	{
+		for (size_t i = 0; i < bins.size(); i++)
+		{
+			bins[i] += other.bins[i];
+		}
+	}
+
+	/**
+	 * The sum, rounded once to the nearest double
+	 */
+	double value() const
+	{
+		// Carry each bin into the next so every bin but the last holds a single bit,
+		// then add the bits from the top down so only the final bits are rounded
+		array<int64_t, 257> carried{};
+		copy(bins.begin(), bins.end(), carried.begin());
+		for (size_t i = 0; i + 1 < carried.size(); i++)
+		{
+			carried[i + 1] += carried[i] >> 1;
+			carried[i] &= 1;
+		}
+
+		double total = 0;
+		for (int i = int(carried.size()) - 1; i >= 0; i--)
+		{
+			total += ldexp(double(carried[i]), i - 150);
+		}
+		return total;
+	}
+
+private:
+	array<int64_t, 256> bins{};
+};
+
+/**
+ * Exactly sum each row of a contiguous row-major grid of water levels.
+ *
+ * Every level is split into two 31-bit integer limbs on a fixed-point scale picked from the largest
+ * level on the board, and the limbs are summed as 64-bit integers. The inner loop only uses
+ * float to int32 conversions and int32 to int64 widening, so it vectorizes on baseline SSE2.
+ * Rows holding levels too small for the two limbs to represent exactly are summed one float at a time instead.
+ * Rows are shared out across threads and combined as integers, so the result is bit-identical
+ * for any thread count or vector width.
+ *
+ * @param rows number of rows in the grid
+ * @param cols number of columns in the grid
+ * @param waterLevels row-major water levels
+ * @param threads number of threads to split the rows across
+ * @param rowSums if given, filled with the sum of each row
+ * @return ExactFloatSum sum of every level on the grid
+ */
+ExactFloatSum sumWaterLevels(int rows, int cols, const vector<float> &waterLevels, int threads = 1, vector<double> *rowSums = nullptr)
+{
+	// The largest magnitude sets the scale; the bit patterns of non-negative floats sort like integers
+	uint32_t maxBits = 0;
+	for (float level : waterLevels)
+	{
+		uint32_t bits;
+		memcpy(&bits, &level, sizeof(bits));
+		maxBits = max(maxBits, bits & 0x7fffffff);
+	}
+	int maxExponent = maxBits >> 23;
+
+	// Scale so the largest level is below 2^30, leaving the high limb in int32 range.
+	// The low limb holds the next 31 bits, so the limbs can't be used if its units would underflow
+	// a float exponent, or if scaling down would push small levels into subnormals.
+	bool hasLimbs = maxExponent >= 37 && maxExponent <= 156;
+	float scale = hasLimbs ? ldexpf(1, 156 - maxExponent) : 1;
+
+	if (rowSums)
+	{
+		rowSums->assign(rows, 0);
+	}
+	threads = max(min(threads, rows), 1);
+	vector<ExactFloatSum> threadSums(threads);
+
+	auto reduceRows = [&](int threadIndex, int firstRow, int lastRow)
+	{
+		TraceSpan span("volume");
+		for (int i = firstRow; i < lastRow; i++)
+		{
+			const float *levels = waterLevels.data() + size_t(i) * cols;
+			ExactFloatSum rowSum;
+
+			int64_t highSum = 0;
+			int64_t lowSum = 0;
+			int inexact = !hasLimbs;
+			if (hasLimbs)
+			{
+				for (int j = 0; j < cols; j++)
+				{
+					// Scaling by a power of 2 and splitting off the integer part are both exact
+					float scaled = levels[j] * scale;
+					int32_t high = int32_t(scaled);
+					float rest = (scaled - float(high)) * 2147483648.0f;
+					int32_t low = int32_t(rest);
+					inexact |= rest != float(low);
+					highSum += high;
+					lowSum += low;
+				}
+			}
+
+			if (inexact)
+			{
+				for (int j = 0; j < cols; j++)
+				{
+					rowSum.add(levels[j]);
+				}
+			}
+			else
+			{
+				rowSum.addUnits(highSum, maxExponent - 6);
+				rowSum.addUnits(lowSum, maxExponent - 37);
+			}
+
+			if (rowSums)
+			{
+				(*rowSums)[i] = rowSum.value();
+			}
+			threadSums[threadIndex].add(rowSum);
+		}
+	};
+
+	vector<thread> workers;
+	for (int t = 1; t < threads; t++)
+	{
+		workers.emplace_back(reduceRows, t, long(rows) * t / threads, long(rows) * (t + 1) / threads);
+	}
+	reduceRows(0, 0, rows / threads);
+	for (auto &worker : workers)
+	{
+		worker.join();
+	}
+
+	ExactFloatSum total;
+	for (const auto &threadSum : threadSums)
+	{
+		total.add(threadSum);
+	}
+	return total;
+}
+
+/**
+ * One level of a min/max downsampled heightmap.
+ * Each cell covers a `blockSize` x `blockSize` block of squares on the original board.
+ */
+struct HeightPyramidLevel
+{
+	int rows;
+	int cols;
+	int blockSize;
+	vector<float> minHeight;
+	vector<float> maxHeight;
+	vector<double> heightSum;
+	vector<int> squareCount;
+	vector<char> isEdge;
+
+	/**
+	 * Build the next coarser level by merging 2x2 blocks of this one
+	 * @return HeightPyramidLevel level with half the rows and columns (rounded up)
+	 */
+	HeightPyramidLevel downsample() const
+	{
+		HeightPyramidLevel coarse;
+		coarse.rows = (rows + 1) / 2;
+		coarse.cols = (cols + 1) / 2;
+		coarse.blockSize = blockSize * 2;
+
+		int size = coarse.rows * coarse.cols;
+		coarse.minHeight.assign(size, 0);
+		coarse.maxHeight.assign(size, 0);
+		coarse.heightSum.assign(size, 0);
+		coarse.squareCount.assign(size, 0);
+		coarse.isEdge.assign(size, false);
+
+		for (int i = 0; i < rows; i++)
+		{
+			for (int j = 0; j < cols; j++)
+			{
+				int fine = i * cols + j;
+				int block = (i / 2) * coarse.cols + (j / 2);
+				bool isFirst = coarse.squareCount[block] == 0;
+				coarse.minHeight[block] = isFirst ? minHeight[fine] : min(coarse.minHeight[block], minHeight[fine]);
+				coarse.maxHeight[block] = isFirst ? maxHeight[fine] : max(coarse.maxHeight[block], maxHeight[fine]);
+				coarse.heightSum[block] += heightSum[fine];
+				coarse.squareCount[block] += squareCount[fine];
+				coarse.isEdge[block] = coarse.isEdge[block] || isEdge[fine];
+			}
+		}
+		return coarse;
+	}
+};
+
+/**
+ * Lower and upper bounds on the volume of water a board holds
+ */
+struct VolumeBounds
+{
+	float lower;
+	float upper;
+
+	/**
+	 * Block size of the pyramid level the bounds were last refined at, 1 once they are exact
+	 */
+	int blockSize;
+};
+
 /**
  * Class to represent the board
  */
@@ -97,6 +874,16 @@ public:
 	int cols;
 	vector<vector<Square>> grid;
 
+	/**
+	 * Number of non-edge squares pruned by the last `markDrySquares()` pass
+	 */
+	int drySquares = 0;
+
+	/**
+	 * Number of non-edge squares left for `flood()` to test after the last `markDrySquares()` pass
+	 */
+	int candidateSquares = 0;
+
 	/**
 	 * Create a new board with random heights
 	 * @param rows number of columns
@@ -105,6 +892,7 @@ public:
 	 */
 	Board(int rows, int cols, bool useFloat = false, float width = 1) : rows(rows), cols(cols)
 	{
+		TraceSpan span("load");
 		for (int i = 0; i < rows; i++)
 		{
 			vector<Square> row;
@@ -128,10 +916,12 @@ public:
 	/**
 	 * Create a new board with given heights
 	 * @param heights 2D array of heights
+	 * @param width width of every square in inches
 	 * @return Board * new board
 	 */
-	Board(const vector<vector<float>> &heights)
+	Board(const vector<vector<float>> &heights, float width = 1)
 	{
+		TraceSpan span("load");
 		rows = heights.size();
 		cols = heights[0].size();
 
@@ -141,7 +931,7 @@ public:
 			for (int j = 0; j < cols; j++)
 			{
 				bool isEdge = (i == 0 || i == rows - 1 || j == 0 || j == cols - 1);
-				row.push_back(Square(heights[i][j], i, j, isEdge));
+				row.push_back(Square(heights[i][j], i, j, isEdge, width));
 			}
 			grid.push_back(row);
 		}
@@ -246,6 +1036,55 @@ public:
 		return lowestNeighbour;
 	}
 
+	/**
+	 * Mark every square that can drain off the board as dry.
+	 *
+	 * A square is dry if there is a path from it to an edge square that never goes uphill,
+	 * since any drop placed on it can always run off the board along that path.
+	 * This is found in a single pass by walking inwards from the edge squares,
+	 * only stepping onto neighbours that are at least as high as the current square.
+	 *
+	 * @return int number of non-edge squares left that could still hold water
+	 */
+	int markDrySquares()
+	{
+		TraceSpan span("drainage");
+		vector<Square *> stack;
+		for (auto &row : grid)
+		{
+			for (auto &square : row)
+			{
+				square.isDry = square.isEdge;
+				if (square.isEdge)
+				{
+					stack.push_back(&square);
+				}
+			}
+		}
+
+		drySquares = 0;
+		while (!stack.empty())
+		{
+			Square *square = stack.back();
+			stack.pop_back();
+
+			vector<Square *> &neighbours = getNeighbours(*square);
+			for (auto &neighbour : neighbours)
+			{
+				if (!neighbour->isDry && neighbour->height >= square->height)
+				{
+					neighbour->isDry = true;
+					drySquares++;
+					stack.push_back(neighbour);
+				}
+			}
+			delete &neighbours;
+		}
+
+		candidateSquares = max(rows - 2, 0) * max(cols - 2, 0) - drySquares;
+		return candidateSquares;
+	}
+
 	/**
 	 * Flood the board with water.
 	 * Water will flow from the highest square to the lowest square.
@@ -255,10 +1094,21 @@ public:
 	 */
 	void flood()
 	{
+		TraceSpan span("flood");
 		// We don't need to test edge squares because regardless
 		// of their height, water will always flow out
 		vector<Square *> &nonEdgeSquares = getNonEdgeSquares();
 
+		// Squares that can drain off the board will never hold water, so skip them too
+		if (markDrySquares() == 0)
+		{
+			delete &nonEdgeSquares;
+			return;
+		}
+		auto removeDry_iter = remove_if(nonEdgeSquares.begin(), nonEdgeSquares.end(), [](Square *s)
+										{ return s->isDry; });
+		nonEdgeSquares.erase(removeDry_iter, nonEdgeSquares.end());
+
 		// Drop one or more water on each non-edge square to populate waterLevel
 		for (Square *square : nonEdgeSquares)
 		{
@@ -320,6 +1170,41 @@ public:
 		}
 	}
 
+	/**
+	 * Flood the board exactly, splitting the work across threads.
+	 * Unlike `flood()` and `levelWater()` this finds every square's water level in one go with
+	 * `getSpillLevelsParallel()`, using the squares marked dry by `markDrySquares()` as the starting points.
+	 * @param threads number of worker threads
+	 */
+	void floodParallel(int threads)
+	{
+		TraceSpan span("flood");
+		if (markDrySquares() == 0)
+		{
+			return;
+		}
+
+		vector<char> isDry;
+		isDry.reserve(rows * cols);
+		for (const auto &row : grid)
+		{
+			for (const auto &square : row)
+			{
+				isDry.push_back(square.isDry);
+			}
+		}
+		vector<float> levels = getSpillLevelsParallel(rows, cols, getHeights(), isDry, threads);
+
+		TraceSpan mergeSpan("merge");
+		for (auto &row : grid)
+		{
+			for (auto &square : row)
+			{
+				square.waterLevel = levels[square.row * cols + square.col] - square.height;
+			}
+		}
+	}
+
 	/**
 	 * Level water across the board.
 	 *
@@ -328,6 +1213,7 @@ public:
 	 */
 	void levelWater()
 	{
+		TraceSpan span("level");
 		int changesMade = 0;
 
 		// Set max attempt as failsafe
@@ -353,65 +1239,304 @@ public:
 													  { return s->waterLevel == 0; });
 				waterNeighbours.erase(removeWaterless_iter, waterNeighbours.end());
 
-				for (auto &neighbour : waterNeighbours)
+				for (auto &neighbour : waterNeighbours)
+				{
+					// If neighbour has higher water level, level their water with self
+					if (neighbour->totalHeight() > waterSquare->totalHeight())
+					{
+						// Level water
+						neighbour->waterLevel = std::max(waterSquare->totalHeight() - neighbour->height, float(0));
+						changesMade++;
+					}
+				}
+
+				// For each water square, get all neighbours without water
+				vector<Square *> &waterlessNeighbours = getNeighbours(*waterSquare);
+				auto removeWater_iter = remove_if(waterlessNeighbours.begin(), waterlessNeighbours.end(), [](Square *s)
+												  { return s->waterLevel > 0; });
+				waterlessNeighbours.erase(removeWater_iter, waterlessNeighbours.end());
+				for (auto &neighbour : waterlessNeighbours)
+				{
+					// If neighbour has lower totalHeight than self, level self with neighbour
+					if (neighbour->totalHeight() < waterSquare->totalHeight())
+					{
+						// Level water
+						waterSquare->waterLevel = std::max(neighbour->totalHeight() - waterSquare->height, float(0));
+						changesMade++;
+					}
+				}
+			}
+		} while (changesMade > 0 && cur++ < max);
+	}
+
+	/**
+	 * Get the total volume of water on the board
+	 * For each square, the water volume is calculated by multiplying the water level (height) by the area of the square's base (width * width)
+	 *
+	 * Water levels are summed exactly with `sumWaterLevels()` and multiplied by the area once at the end,
+	 * so the total doesn't drift with board size and is the same for any number of threads.
+	 * @param threads number of threads to split the rows across
+	 */
+	float getWaterVolume(int threads = 1)
+	{
+		TraceSpan span("volume");
+		double area = double(grid[0][0].width) * grid[0][0].width;
+		return float(sumWaterLevels(rows, cols, getWaterLevels(), threads).value() * area);
+	}
+
+	/**
+	 * Get the volume of water held by each row of the board
+	 * @param threads number of threads to split the rows across
+	 * @return vector<float> volume of each row
+	 */
+	vector<float> getRowVolumes(int threads = 1)
+	{
+		double area = double(grid[0][0].width) * grid[0][0].width;
+		vector<double> rowSums;
+		sumWaterLevels(rows, cols, getWaterLevels(), threads, &rowSums);
+
+		vector<float> rowVolumes;
+		rowVolumes.reserve(rows);
+		for (double rowSum : rowSums)
+		{
+			rowVolumes.push_back(float(rowSum * area));
+		}
+		return rowVolumes;
+	}
+
+	/**
+	 * Estimate the volume of water the board holds without flooding it, coarse to fine.
+	 *
+	 * The heightmap is downsampled into a pyramid of blocks that keep the min and max height of the squares they cover.
+	 * Solving a level using block max heights can only raise the water surface, since any route to the edge
+	 * is at least as high, giving an upper bound; solving with block min heights likewise gives a lower bound.
+	 * Levels are solved from the coarsest up, tightening the bounds until they meet on the original board.
+	 *
+	 * @param maxGap stop refining once upper - lower is at most this volume (0 to refine until exact)
+	 * @param timeBudgetMs stop refining once this much time has passed (0 for no limit)
+	 * @param onProgress called with the current bounds after each level is solved
+	 * @return VolumeBounds tightest bounds found
+	 */
+	VolumeBounds approximateVolume(float maxGap = 0, double timeBudgetMs = 0, function<void(const VolumeBounds &)> onProgress = nullptr)
+	{
+		TraceSpan span("approximate");
+		auto start = chrono::steady_clock::now();
+		float area = grid[0][0].width * grid[0][0].width;
+
+		vector<HeightPyramidLevel> pyramid(1);
+		{
+			TraceSpan pyramidSpan("pyramid");
+			HeightPyramidLevel &base = pyramid[0];
+			base.rows = rows;
+			base.cols = cols;
+			base.blockSize = 1;
+			base.minHeight = getHeights();
+			base.maxHeight = base.minHeight;
+			base.heightSum.assign(base.minHeight.begin(), base.minHeight.end());
+			base.squareCount.assign(rows * cols, 1);
+			for (const auto &row : grid)
+			{
+				for (const auto &square : row)
+				{
+					base.isEdge.push_back(square.isEdge);
+				}
+			}
+			while (pyramid.back().rows > 2 || pyramid.back().cols > 2)
+			{
+				pyramid.push_back(pyramid.back().downsample());
+			}
+		}
+
+		VolumeBounds bounds = {0, numeric_limits<float>::infinity(), pyramid.back().blockSize};
+		for (auto level = pyramid.rbegin(); level != pyramid.rend(); ++level)
+		{
+			TraceSpan levelSpan("refine");
+			vector<float> upperLevels = getSpillLevels(level->rows, level->cols, level->maxHeight, level->isEdge);
+			vector<float> lowerLevels = level->blockSize == 1 ? upperLevels : getSpillLevels(level->rows, level->cols, level->minHeight, level->isEdge);
+
+			double lower = 0;
+			double upper = 0;
+			for (size_t i = 0; i < upperLevels.size(); i++)
+			{
+				upper += double(upperLevels[i]) * level->squareCount[i] - level->heightSum[i];
+				lower += max(double(lowerLevels[i]) * level->squareCount[i] - level->heightSum[i], 0.0);
+			}
+
+			// Every level gives valid bounds, so keep the tightest seen so far
+			bounds.lower = max(bounds.lower, float(lower * area));
+			bounds.upper = min(bounds.upper, float(upper * area));
+			bounds.blockSize = level->blockSize;
+			if (onProgress)
+			{
+				onProgress(bounds);
+			}
+
+			double elapsedMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+			if (bounds.upper - bounds.lower <= maxGap || (timeBudgetMs > 0 && elapsedMs >= timeBudgetMs))
+			{
+				break;
+			}
+		}
+		return bounds;
+	}
+
+	/**
+	 * Get the total volume of water on the board
+	 */
+	void resetTouched()
+	{
+		for (auto &row : grid)
+		{
+			for (auto &square : row)
+			{
+				square.isTouched = false;
+			}
+		}
+	}
+
+	/**
+	 * Get the height of every square as one contiguous row-major array
+	 * @return vector<float> rows * cols heights
+	 */
+	vector<float> getHeights() const
+	{
+		vector<float> heights;
+		heights.reserve(rows * cols);
+		for (const auto &row : grid)
+		{
+			for (const auto &square : row)
+			{
+				heights.push_back(square.height);
+			}
+		}
+		return heights;
+	}
+
+	/**
+	 * Get the water level of every square as one contiguous row-major array
+	 * @return vector<float> rows * cols water levels
+	 */
+	vector<float> getWaterLevels() const
+	{
+		vector<float> waterLevels;
+		waterLevels.reserve(rows * cols);
+		for (const auto &row : grid)
+		{
+			for (const auto &square : row)
+			{
+				waterLevels.push_back(square.waterLevel);
+			}
+		}
+		return waterLevels;
+	}
+
+	/**
+	 * Export the board as a binary PPM heat map, one pixel per square.
+	 * Dry squares are shaded grey by height, flooded squares are shaded blue by water depth.
+	 * @param path file to write
+	 * @return bool true if the file was written
+	 */
+	bool exportHeatmap(const string &path) const
+	{
+		TraceSpan span("output");
+		float minHeight = grid[0][0].height;
+		float maxHeight = grid[0][0].height;
+		float maxDepth = 0;
+		for (const auto &row : grid)
+		{
+			for (const auto &square : row)
+			{
+				minHeight = min(minHeight, square.height);
+				maxHeight = max(maxHeight, square.height);
+				maxDepth = max(maxDepth, square.waterLevel);
+			}
+		}
+		float heightRange = maxHeight > minHeight ? maxHeight - minHeight : 1;
+		float depthRange = maxDepth > 0 ? maxDepth : 1;
+
+		string buffer = "P6\n" + to_string(cols) + " " + to_string(rows) + "\n255\n";
+		size_t offset = buffer.size();
+		buffer.resize(offset + size_t(rows) * cols * 3);
+		for (const auto &row : grid)
+		{
+			for (const auto &square : row)
+			{
+				unsigned char *pixel = reinterpret_cast<unsigned char *>(&buffer[offset]);
+				if (square.waterLevel > 0)
 				{
-					// If neighbour has higher water level, level their water with self
-					if (neighbour->totalHeight() > waterSquare->totalHeight())
-					{
-						// Level water
-						neighbour->waterLevel = std::max(waterSquare->totalHeight() - neighbour->height, float(0));
-						changesMade++;
-					}
+					float depth = square.waterLevel / depthRange;
+					pixel[0] = (unsigned char)(30 * (1 - depth));
+					pixel[1] = (unsigned char)(90 + 110 * (1 - depth));
+					pixel[2] = (unsigned char)(160 + 95 * (1 - depth));
 				}
-
-				// For each water square, get all neighbours without water
-				vector<Square *> &waterlessNeighbours = getNeighbours(*waterSquare);
-				auto removeWater_iter = remove_if(waterlessNeighbours.begin(), waterlessNeighbours.end(), [](Square *s)
-												  { return s->waterLevel > 0; });
-				waterlessNeighbours.erase(removeWater_iter, waterlessNeighbours.end());
-				for (auto &neighbour : waterlessNeighbours)
+				else
 				{
-					// If neighbour has lower totalHeight than self, level self with neighbour
-					if (neighbour->totalHeight() < waterSquare->totalHeight())
-					{
-						// Level water
-						waterSquare->waterLevel = std::max(neighbour->totalHeight() - waterSquare->height, float(0));
-						changesMade++;
-					}
+					unsigned char shade = (unsigned char)(40 + 215 * (square.height - minHeight) / heightRange);
+					pixel[0] = pixel[1] = pixel[2] = shade;
 				}
+				offset += 3;
 			}
-		} while (changesMade > 0 && cur++ < max);
+		}
+
+		ofstream file(path, ios::binary);
+		file.write(buffer.data(), buffer.size());
+		return bool(file);
 	}
 
 	/**
-	 * Get the total volume of water on the board
-	 * For each square, the water volume is calculated by multiplying the water level (height) by the area of the square's base (width * width)
+	 * Export the heights and water levels as `<prefix>_heights.npy` and `<prefix>_water.npy`,
+	 * each a (rows, cols) float32 array.
+	 * @param prefix path prefix for the output files
+	 * @return bool true if both files were written
+	 */
+	bool exportNpy(const string &prefix) const
+	{
+		TraceSpan span("output");
+		vector<size_t> shape = {size_t(rows), size_t(cols)};
+		bool heightsOk = writeNpy(prefix + "_heights.npy", getHeights(), shape, "<f4");
+		bool waterOk = writeNpy(prefix + "_water.npy", getWaterLevels(), shape, "<f4");
+		return heightsOk && waterOk;
+	}
+
+	/**
+	 * Export the flooded surface as an indexed triangle mesh.
+	 * `<prefix>_vertices.npy` is a (rows * cols, 3) float32 array with one vertex per square centre
+	 * at its total height, and `<prefix>_faces.npy` is a (faces, 3) int32 array of vertex indices,
+	 * two triangles per 2x2 block of squares.
+	 * @param prefix path prefix for the output files
+	 * @return bool true if both files were written
 	 */
-	float getWaterVolume()
+	bool exportMesh(const string &prefix) const
 	{
-		float volume = 0;
+		TraceSpan span("output");
+		vector<float> vertices;
+		vertices.reserve(size_t(rows) * cols * 3);
 		for (const auto &row : grid)
 		{
 			for (const auto &square : row)
 			{
-				volume += square.waterLevel * square.width * square.width;
+				vertices.push_back((square.col + 0.5f) * square.width);
+				vertices.push_back((square.row + 0.5f) * square.width);
+				vertices.push_back(square.totalHeight());
 			}
 		}
-		return volume;
-	}
 
-	/**
-	 * Get the total volume of water on the board
-	 */
-	void resetTouched()
-	{
-		for (auto &row : grid)
+		vector<int32_t> faces;
+		faces.reserve(size_t(max(rows - 1, 0)) * max(cols - 1, 0) * 6);
+		for (int i = 0; i < rows - 1; i++)
 		{
-			for (auto &square : row)
+			for (int j = 0; j < cols - 1; j++)
 			{
-				square.isTouched = false;
+				int32_t topLeft = i * cols + j;
+				int32_t bottomLeft = topLeft + cols;
+				faces.insert(faces.end(), {topLeft, bottomLeft, topLeft + 1});
+				faces.insert(faces.end(), {topLeft + 1, bottomLeft, bottomLeft + 1});
 			}
 		}
+
+		bool verticesOk = writeNpy(prefix + "_vertices.npy", vertices, {size_t(rows) * cols, 3}, "<f4");
+		bool facesOk = writeNpy(prefix + "_faces.npy", faces, {faces.size() / 3, 3}, "<i4");
+		return verticesOk && facesOk;
 	}
 
 	/**
@@ -419,15 +1544,16 @@ public:
 	 */
 	void printBoard()
 	{
+		TraceSpan span("output");
 		// Column Headers 1 - 26
 		cout << "    ";
 		for (int i = 0; i < cols; i++)
 		{
 			cout << " " << (i + 1) << " ";
 		}
-		cout << endl;
+		cout << "\n";
 
-		cout << "-----------------------------" << endl;
+		cout << "-----------------------------\n";
 		for (const auto &row : grid)
 		{
 			// Row Headers A - Z
@@ -446,12 +1572,279 @@ public:
 				}
 			}
 			cout << "|";
-			cout << endl;
+			cout << "\n";
 		}
 		cout << "-----------------------------" << endl;
 	}
 };
 
+/**
+ * Compact version of the board for large, integer or low precision heightmaps.
+ *
+ * Heights are quantized to T (uint8_t or uint16_t) as `offset + scale * value`,
+ * the edge and visited flags are bit-packed, and one square width is shared by the whole board.
+ * Water is stored as the quantized height of the water surface, which is always one of the board's heights.
+ */
+template <typename T>
+class CompactBoard
+{
+public:
+	int rows;
+	int cols;
+	float width;
+	float scale;
+	float offset;
+	vector<T> heights;
+	vector<T> levels;
+	vector<uint64_t> edgeMask;
+	vector<uint64_t> visitedMask;
+
+	/**
+	 * Number of non-edge squares pruned by the last `markDrySquares()` pass
+	 */
+	int drySquares = 0;
+
+	/**
+	 * Number of non-edge squares left that could hold water after the last `markDrySquares()` pass
+	 */
+	int candidateSquares = 0;
+
+	/**
+	 * Create a compact board from raw heights, without building a `Board` first
+	 * @param rows number of rows
+	 * @param cols number of columns
+	 * @param rawHeights row-major heights to quantize
+	 * @param width width of every square in inches
+	 * @param scale height of one quantization step, or 0 to fit the height range
+	 *              (integer heights that fit in T are stored exactly)
+	 */
+	CompactBoard(int rows, int cols, const vector<float> &rawHeights, float width = 1, float scale = 0)
+		: rows(rows), cols(cols), width(width), scale(scale)
+	{
+		TraceSpan span("load");
+		float minHeight = *min_element(rawHeights.begin(), rawHeights.end());
+		float maxHeight = *max_element(rawHeights.begin(), rawHeights.end());
+		bool isInteger = all_of(rawHeights.begin(), rawHeights.end(), [](float h)
+								{ return h == float(int(h)); });
+
+		float maxValue = numeric_limits<T>::max();
+		offset = minHeight;
+		if (this->scale <= 0)
+		{
+			this->scale = (isInteger && maxHeight - minHeight <= maxValue) || maxHeight == minHeight ? 1 : (maxHeight - minHeight) / maxValue;
+		}
+
+		heights.reserve(rawHeights.size());
+		for (float height : rawHeights)
+		{
+			heights.push_back(T(min(max((height - offset) / this->scale + 0.5f, 0.0f), maxValue)));
+		}
+		initialise();
+	}
+
+	/**
+	 * Create a compact board from heights that are already quantized
+	 * @param rows number of rows
+	 * @param cols number of columns
+	 * @param quantizedHeights row-major heights, each `offset + scale * value` inches
+	 * @param scale height of one quantization step
+	 * @param offset height of a quantized 0
+	 * @param width width of every square in inches
+	 */
+	CompactBoard(int rows, int cols, vector<T> quantizedHeights, float scale, float offset, float width = 1)
+		: rows(rows), cols(cols), width(width), scale(scale), offset(offset), heights(move(quantizedHeights))
+	{
+		initialise();
+	}
+
+	/**
+	 * Create a compact copy of a board
+	 * @param board board to quantize
+	 * @param scale height of one quantization step, or 0 to fit the board's height range
+	 */
+	CompactBoard(const Board &board, float scale = 0)
+		: CompactBoard(board.rows, board.cols, board.getHeights(), board.grid[0][0].width, scale)
+	{
+	}
+
+	float getHeight(int square) const
+	{
+		return offset + scale * heights[square];
+	}
+
+	float getWaterLevel(int square) const
+	{
+		return scale * (levels[square] - heights[square]);
+	}
+
+	/**
+	 * Mark every square that can drain off the board in `visitedMask`.
+	 * Same walk as `Board::markDrySquares()`, inwards from the edge over non-ascending steps.
+	 * @return int number of non-edge squares left that could still hold water
+	 */
+	int markDrySquares()
+	{
+		TraceSpan span("drainage");
+		visitedMask = edgeMask;
+
+		vector<int> stack;
+		for (int i = 0; i < rows * cols; i++)
+		{
+			if (testBit(edgeMask, i))
+			{
+				stack.push_back(i);
+			}
+		}
+
+		drySquares = 0;
+		while (!stack.empty())
+		{
+			int square = stack.back();
+			stack.pop_back();
+			for (int neighbour : getNeighbours(square))
+			{
+				if (neighbour >= 0 && !testBit(visitedMask, neighbour) && heights[neighbour] >= heights[square])
+				{
+					setBit(visitedMask, neighbour);
+					drySquares++;
+					stack.push_back(neighbour);
+				}
+			}
+		}
+
+		candidateSquares = max(rows - 2, 0) * max(cols - 2, 0) - drySquares;
+		return candidateSquares;
+	}
+
+	/**
+	 * Flood the board with water, setting the water surface level of every square.
+	 *
+	 * Since heights are small integers, this is a priority flood using one bucket per height:
+	 * starting from the squares marked dry by `markDrySquares()`, whose water surface is already known
+	 * to be their own height, always grow inwards from the lowest bucket, so every square is reached
+	 * along the lowest possible route off the board and its water surface is the highest step on that route.
+	 */
+	void flood()
+	{
+		TraceSpan span("flood");
+		levels = heights;
+		if (markDrySquares() == 0)
+		{
+			return;
+		}
+
+		// One bucket per height actually used, not per value T can hold
+		vector<vector<int>> buckets(size_t(*max_element(heights.begin(), heights.end())) + 1);
+
+		// `visitedMask` now holds the dry squares. Only those next to a square that could hold water
+		// need to be queued; the rest of the dry region can't raise anything.
+		for (int i = 0; i < rows * cols; i++)
+		{
+			if (!testBit(visitedMask, i))
+			{
+				continue;
+			}
+			for (int neighbour : getNeighbours(i))
+			{
+				if (neighbour >= 0 && !testBit(visitedMask, neighbour))
+				{
+					buckets[heights[i]].push_back(i);
+					break;
+				}
+			}
+		}
+
+		for (size_t level = 0; level < buckets.size(); level++)
+		{
+			// Buckets can grow while they are being drained, so don't hold on to iterators
+			while (!buckets[level].empty())
+			{
+				int square = buckets[level].back();
+				buckets[level].pop_back();
+				for (int neighbour : getNeighbours(square))
+				{
+					if (neighbour >= 0 && !testBit(visitedMask, neighbour))
+					{
+						setBit(visitedMask, neighbour);
+						levels[neighbour] = max(heights[neighbour], T(level));
+						buckets[levels[neighbour]].push_back(neighbour);
+					}
+				}
+			}
+		}
+	}
+
+	/**
+	 * Get the total volume of water on the board.
+	 * Depths are summed exactly as integers before being scaled back to inches.
+	 */
+	float getWaterVolume() const
+	{
+		TraceSpan span("volume");
+		uint64_t steps = 0;
+		for (size_t i = 0; i < heights.size(); i++)
+		{
+			steps += levels[i] - heights[i];
+		}
+		return float(double(steps) * scale * width * width);
+	}
+
+	/**
+	 * Bytes used to store the board's squares
+	 */
+	size_t memoryFootprint() const
+	{
+		return (heights.size() + levels.size()) * sizeof(T) + (edgeMask.size() + visitedMask.size()) * sizeof(uint64_t);
+	}
+
+private:
+	/**
+	 * Set up water levels and flag masks once the heights are in place.
+	 * Edge squares are the outer ring of the board, as for `Board`.
+	 */
+	void initialise()
+	{
+		levels = heights;
+		edgeMask.assign((size_t(rows) * cols + 63) / 64, 0);
+		visitedMask.assign(edgeMask.size(), 0);
+		for (int i = 0; i < rows; i++)
+		{
+			for (int j = 0; j < cols; j++)
+			{
+				if (i == 0 || i == rows - 1 || j == 0 || j == cols - 1)
+				{
+					setBit(edgeMask, i * cols + j);
+				}
+			}
+		}
+	}
+
+	static bool testBit(const vector<uint64_t> &mask, int bit)
+	{
+		return (mask[bit / 64] >> (bit % 64)) & 1;
+	}
+
+	static void setBit(vector<uint64_t> &mask, int bit)
+	{
+		mask[bit / 64] |= uint64_t(1) << (bit % 64);
+	}
+
+	/**
+	 * Indices of the squares up, down, left and right of the given square, or -1 past the edge of the board
+	 */
+	array<int, 4> getNeighbours(int square) const
+	{
+		int row = square / cols;
+		int col = square % cols;
+		return {
+			row > 0 ? square - cols : -1,
+			row < rows - 1 ? square + cols : -1,
+			col > 0 ? square - 1 : -1,
+			col < cols - 1 ? square + 1 : -1,
+		};
+	}
+};
+
 /**
  * Flood the board with water and provide sample output and stats
  *
@@ -477,9 +1870,31 @@ void floodBoard(Board &board)
 	board.printBoard();
 
 	cout << "Volume: " << board.getWaterVolume() << " inches cubed" << endl;
+	cout << "Dry squares pruned: " << board.drySquares << " of " << (board.drySquares + board.candidateSquares) << endl;
 	cout << "Calculation time: " << duration.count() / 1000.0 << " ms" << endl;
 }
 
+/**
+ * Flood the board and export it for visualisation with `render-board.py`
+ *
+ * @param board The board to flood
+ * @param prefix Path prefix for the exported files
+ */
+void exportBoard(Board &board, const string &prefix)
+{
+	board.floodParallel(max(thread::hardware_concurrency(), 1u));
+
+	if (board.exportHeatmap(prefix + ".ppm") && board.exportNpy(prefix) && board.exportMesh(prefix))
+	{
+		cout << "Exported " << board.rows << "x" << board.cols << " board to " << prefix << ".ppm, "
+			 << prefix << "_{heights,water,vertices,faces}.npy" << endl;
+	}
+	else
+	{
+		cerr << "Failed to export board to " << prefix << endl;
+	}
+}
+
 // ---------------------------- MENU ----------------------------
 
 /**
@@ -660,7 +2075,144 @@ void runUnitTests()
 		board.flood();
 		board.levelWater();
 		ASSERT_EQUAL(sampleBoards[i].expectedVolume, board.getWaterVolume());
+
+		// Squares marked dry by the drainage pre-pass must never end up holding water
+		int wetDrySquares = 0;
+		for (Square *square : board.getWaterSquares())
+		{
+			if (square->isDry)
+			{
+				wetDrySquares++;
+			}
+		}
+		ASSERT_EQUAL(0, wetDrySquares);
 	}
+
+	// Approximate volume bounds must always contain the exact volume, and meet it once fully refined
+	for (size_t i = 0; i < sizeof(sampleBoards) / sizeof(SampleBoard); i++)
+	{
+		Board board = sampleBoards[i].board;
+		float expectedVolume = sampleBoards[i].expectedVolume;
+		int outOfBounds = 0;
+		VolumeBounds bounds = board.approximateVolume(0, 0, [&](const VolumeBounds &progress)
+													  { outOfBounds += progress.lower > expectedVolume || progress.upper < expectedVolume; });
+		ASSERT_EQUAL(0, outOfBounds);
+		ASSERT_EQUAL(expectedVolume, bounds.lower);
+		ASSERT_EQUAL(expectedVolume, bounds.upper);
+	}
+
+	// Compact boards should hold the same volume, at a fraction of the memory
+	for (size_t i = 0; i < sizeof(sampleBoards) / sizeof(SampleBoard); i++)
+	{
+		CompactBoard<uint8_t> compact(sampleBoards[i].board);
+		compact.flood();
+		ASSERT_EQUAL(sampleBoards[i].expectedVolume, compact.getWaterVolume());
+	}
+	CompactBoard<uint8_t> rawBasin(8, 8, sampleBoards[2].board.getHeights());
+	rawBasin.flood();
+	ASSERT_EQUAL(sampleBoards[2].expectedVolume, rawBasin.getWaterVolume());
+
+	// Non-integer heights are scaled to fit T. Quantizing is monotone, so every water surface lands on
+	// the quantized height of the exact surface, and each square's depth is off by at most one step
+	vector<vector<float>> hillHeights(16, vector<float>(16));
+	for (int i = 0; i < 16; i++)
+	{
+		for (int j = 0; j < 16; j++)
+		{
+			hillHeights[i][j] = 50 + 40 * sin(i * 0.7f) * cos(j * 0.9f) + (i * j % 7) * 0.37f;
+		}
+	}
+	Board hills(hillHeights, 0.5f);
+	hills.floodParallel(1);
+	float exactHillVolume = hills.getWaterVolume();
+	CompactBoard<uint8_t> compactHills8(hills);
+	CompactBoard<uint16_t> compactHills16(hills);
+	compactHills8.flood();
+	compactHills16.flood();
+	ASSERT_EQUAL(true, compactHills8.scale != 1 && compactHills16.scale < compactHills8.scale);
+	ASSERT_EQUAL(true, abs(compactHills8.getWaterVolume() - exactHillVolume) <= compactHills8.scale * 16 * 16 * 0.5f * 0.5f);
+	ASSERT_EQUAL(true, abs(compactHills16.getWaterVolume() - exactHillVolume) <= compactHills16.scale * 16 * 16 * 0.5f * 0.5f);
+
+	CompactBoard<uint16_t> compactPyramid(sampleBoards[6].board);
+	ASSERT_EQUAL(0, compactPyramid.markDrySquares());
+	ASSERT_EQUAL(true, 4 * compactPyramid.memoryFootprint() <= 64 * sizeof(Square));
+
+	// The parallel flood should be exact for any number of threads
+	for (int threads : {1, 4})
+	{
+		for (size_t i = 0; i < sizeof(sampleBoards) / sizeof(SampleBoard); i++)
+		{
+			Board board = sampleBoards[i].board;
+			board.floodParallel(threads);
+			ASSERT_EQUAL(sampleBoards[i].expectedVolume, board.getWaterVolume());
+		}
+	}
+	// Same kind of heights as a complex random board, from a fixed seed so failures can be reproduced
+	mt19937 generator(31);
+	vector<vector<float>> randomGrid(64, vector<float>(64));
+	for (auto &row : randomGrid)
+	{
+		for (auto &height : row)
+		{
+			height = (generator() % 10000) / 100.0f;
+		}
+	}
+	Board randomBoard(randomGrid);
+	vector<float> randomHeights = randomBoard.getHeights();
+	vector<char> randomEdges;
+	for (const auto &row : randomBoard.grid)
+	{
+		for (const auto &square : row)
+		{
+			randomEdges.push_back(square.isEdge);
+		}
+	}
+	vector<float> serialLevels = getSpillLevels(64, 64, randomHeights, randomEdges);
+	vector<float> parallelLevels = getSpillLevelsParallel(64, 64, randomHeights, randomEdges, 8);
+	ASSERT_EQUAL(true, serialLevels == parallelLevels);
+
+	// Volume reduction should be bit-identical for any number of threads
+	randomBoard.floodParallel(4);
+	float singleThreadVolume = randomBoard.getWaterVolume(1);
+	vector<float> singleThreadRows = randomBoard.getRowVolumes(1);
+	for (int threads : {2, 3, 8})
+	{
+		ASSERT_EQUAL(singleThreadVolume, randomBoard.getWaterVolume(threads));
+		ASSERT_EQUAL(true, singleThreadRows == randomBoard.getRowVolumes(threads));
+	}
+
+	// Volumes should stay exact on fine grids and for tiny depths, even next to deep water
+	Board fineBasin({
+						{9, 9, 9, 9},
+						{9, 0, 0, 9},
+						{9, 0, 0, 9},
+						{9, 9, 9, 9},
+					},
+					0.001f);
+	fineBasin.floodParallel(1);
+	ASSERT_EQUAL(float(36 * double(0.001f) * double(0.001f)), fineBasin.getWaterVolume());
+
+	Board shallowPuddle({
+		{1.19e-7f, 1.19e-7f, 1.19e-7f},
+		{1.19e-7f, 0, 1.19e-7f},
+		{1.19e-7f, 1.19e-7f, 1.19e-7f},
+	});
+	shallowPuddle.floodParallel(1);
+	ASSERT_EQUAL(1.19e-7f, shallowPuddle.getWaterVolume());
+
+	Board mixedDepths({
+		{1e6f, 1e6f, 1e6f, 1e6f, 1e-6f, 1e-6f},
+		{1e6f, 0, 1e6f, 1e-6f, 0, 1e-6f},
+		{1e6f, 1e6f, 1e6f, 1e-6f, 1e-6f, 1e-6f},
+	});
+	mixedDepths.floodParallel(1);
+	ASSERT_EQUAL(float(1e6f + double(1e-6f)), mixedDepths.getWaterVolume());
+	ASSERT_EQUAL(float(1e6f + double(1e-6f)), mixedDepths.getRowVolumes(2)[1]);
+
+	// Pyramid drains off every side, so the pre-pass should prune the whole board
+	Board pyramid = sampleBoards[6].board;
+	ASSERT_EQUAL(0, pyramid.markDrySquares());
+	ASSERT_EQUAL(36, pyramid.drySquares);
 }
 
 /**
@@ -720,7 +2272,10 @@ void demoMenu()
 		cout << "\n"
 			 << endl;
 
-		std::cin >> choice;
+		if (!(std::cin >> choice))
+		{
+			return;
+		}
 
 		switch (choice)
 		{
@@ -771,15 +2326,90 @@ void displayMenu()
 		 << endl;
 }
 
-int main()
+/**
+ * Print the command line options.
+ */
+void printUsage(const char *program)
+{
+	cerr << "Usage: " << program << " [--trace <path>] [--export <prefix> [rows] [cols]]\n"
+		 << "  --trace <path>                    write a Chrome trace of the solver phases on exit\n"
+		 << "  --export <prefix> [rows] [cols]   flood a random board and export it, without the menu\n"
+		 << "With no --export, the interactive menu is shown." << endl;
+}
+
+/**
+ * Parse a board size given on the command line
+ * @return int the size, or -1 if it isn't a whole number
+ */
+int parseBoardSize(const char *arg)
+{
+	char *end;
+	long size = strtol(arg, &end, 10);
+	return *end == '\0' && size <= 1 << 20 ? int(size) : -1;
+}
+
+int main(int argc, char *argv[])
 {
 	srand(time(NULL)); // Seed the random number generator
 	int choice;
 
+	// Command line options, see `printUsage()`
+	string exportPrefix;
+	int exportRows = 8;
+	int exportCols = 8;
+	for (int i = 1; i < argc; i++)
+	{
+		string arg = argv[i];
+		bool hasValue = i + 1 < argc && argv[i + 1][0] != '-';
+		if (arg == "--trace" && hasValue)
+		{
+			if (!Tracer::instance().enable(argv[++i]))
+			{
+				cerr << "Failed to open trace file " << argv[i] << endl;
+				return 1;
+			}
+		}
+		else if (arg == "--export" && hasValue)
+		{
+			exportPrefix = argv[++i];
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+			{
+				exportRows = exportCols = parseBoardSize(argv[++i]);
+			}
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+			{
+				exportCols = parseBoardSize(argv[++i]);
+			}
+			if (exportRows < 1 || exportCols < 1)
+			{
+				cerr << "Board rows and columns must be whole numbers of at least 1" << endl;
+				printUsage(argv[0]);
+				return 1;
+			}
+		}
+		else
+		{
+			cerr << (arg == "--trace" || arg == "--export" ? "Missing value for " : "Unknown option ") << arg << endl;
+			printUsage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (!exportPrefix.empty())
+	{
+		Board board(exportRows, exportCols, true);
+		exportBoard(board, exportPrefix);
+		return 0;
+	}
+
 	while (true)
 	{
 		displayMenu();
-		std::cin >> choice;
+		if (!(std::cin >> choice))
+		{
+			cout << "Exiting..." << endl;
+			return 0;
+		}
 
 		switch (choice)
 		{
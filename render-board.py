@@ -1,3 +1,4 @@
+import sys
 import numpy as np
 import matplotlib.pyplot as plt
 from matplotlib.colors import to_rgba, LightSource
@@ -24,6 +25,27 @@ height_map = np.array(height_map)
 fig = plt.figure()
 ax = fig.add_subplot(111, projection='3d')
 
+# Render a board exported with `chess-board --export <prefix> [rows] [cols]`
+# The arrays are memory-mapped rather than copied, and the whole mesh is drawn in one call
+if len(sys.argv) > 1:
+    prefix = sys.argv[1]
+    vertices = np.load(prefix + '_vertices.npy', mmap_mode='r')
+    faces = np.load(prefix + '_faces.npy', mmap_mode='r')
+    water = np.load(prefix + '_water.npy', mmap_mode='r').reshape(-1)
+
+    surface = ax.plot_trisurf(vertices[:, 0], vertices[:, 1], vertices[:, 2], triangles=faces, linewidth=0)
+
+    # Colour each triangle by the average water depth of its corners
+    surface.set_array(water[faces].mean(axis=1))
+    surface.set_cmap('Blues')
+
+    ax.set_xlabel('X')
+    ax.set_ylabel('Y')
+    ax.set_zlabel('Height')
+
+    plt.show()
+    sys.exit()
+
 x_size, y_size = height_map.shape
 
 x = np.arange(x_size)